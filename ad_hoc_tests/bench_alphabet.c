@@ -0,0 +1,60 @@
+/*****
+ Replays ingredient names through the pantry trie and times trie_node_find_or_create() alone.
+ Built by bench_alphabet.py, once per TRIE_ALPHABET: reads the names from stdin (one per line),
+ inserts them all, then descends <lookups> times along a pseudo-random sequence of them.
+                                                                  *****/
+
+#define main trie_test_main // we bring our own
+#include "../trie_test.c"
+#undef main
+
+#include <time.h>
+
+#define MAX_BENCH_NAMES 100000
+
+char *names[MAX_BENCH_NAMES];
+
+int main(int argc, char **argv)
+{
+  long lookups = argc > 1 ? atol(argv[1]) : 10000000;
+  trie_node_pool = calloc(sizeof(TrieNode_t), MAX_TRIE_NODES);
+  ingredients_root = &trie_node_pool[trie_malloc()];
+
+  char name[256];
+  int name_count = 0;
+  long name_bytes = 0;
+  while (name_count < MAX_BENCH_NAMES && scanf("%255s", name) == 1)
+  {
+    names[name_count++] = strdup(name);
+    name_bytes += strlen(name);
+    trie_node_find_or_create(ingredients_root, name, true);
+  }
+  assert(name_count);
+
+  // the sequence is drawn up front, so the timed loop is nothing but descents
+  int *sequence = malloc(sizeof(int) * lookups);
+  uint32_t state = 2024;
+  for (long i = 0; i < lookups; i++)
+  {
+    state = state * 1664525 + 1013904223; // good old LCG
+    sequence[i] = (state >> 8) % name_count;
+  }
+
+  uintptr_t sink = 0; // keeps the descents from being optimized away
+  struct timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (long i = 0; i < lookups; i++)
+    sink ^= (uintptr_t)trie_node_find_or_create(ingredients_root, names[sequence[i]], false);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  double elapsed_ns = (end.tv_sec - start.tv_sec) * 1e9 + (end.tv_nsec - start.tv_nsec);
+  // alphabet size, node size, nodes, ns/descent, ns/byte, checksum
+  printf("%d %lu %d %.2f %.3f %lx\n",
+         TRIE_ALPHABET_SIZE,
+         sizeof(TrieNode_t),
+         numero_trie_nodes,
+         elapsed_ns / lookups,
+         elapsed_ns / (lookups * ((double)name_bytes / name_count)),
+         (unsigned long)sink);
+  return 0;
+}
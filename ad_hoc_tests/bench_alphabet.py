@@ -0,0 +1,62 @@
+#!/Users/manchineel/.pyenv/shims/python
+import os
+import sys
+import random
+import subprocess
+
+script_dir = os.path.dirname(os.path.realpath(__file__))
+driver = os.path.join(script_dir, "bench_alphabet.c")
+
+USAGE_NOTE = "Usage: bench_alphabet.py [distinct_ingredients] [lookups] [runs]"
+ALPHABETS = {
+    # name: TRIE_ALPHABET (ALPHABET_LOWER = 1, ALPHABET_UPPER = 2, ALPHABET_DIGIT = 4, ALPHABET_UNDERSCORE = 8)
+    "default [a-zA-Z0-9_]": 15,
+    "reduced [a-z0-9_]": 13,
+}
+
+
+# Names that fit in both alphabets, so both tries end up with the very same shape
+def gen_names(distinct, seed=2024):
+    rng = random.Random(seed)
+    symbols = "abcdefghijklmnopqrstuvwxyz0123456789_"
+    names = set()
+    while len(names) < distinct:
+        names.add("".join(rng.choice(symbols) for _ in range(rng.randint(6, 20))))
+    return "\n".join(sorted(names)) + "\n"
+
+
+if __name__ == "__main__":
+    try:
+        distinct = int(sys.argv[1]) if len(sys.argv) > 1 else 2000
+        lookups = int(sys.argv[2]) if len(sys.argv) > 2 else 10000000
+        runs = int(sys.argv[3]) if len(sys.argv) > 3 else 5
+    except ValueError:
+        print(USAGE_NOTE)
+        sys.exit(1)
+
+    names = gen_names(distinct)
+    max_trie_nodes = len(names) + 1  # one node per byte at worst (newlines included), plus the root
+
+    for name, alphabet in ALPHABETS.items():
+        binary = os.path.join(script_dir, f"bench_alphabet_{alphabet}")
+        # the driver #includes trie_test.c, compiler errors go straight to the terminal
+        subprocess.run(
+            ["gcc", "-std=gnu11", "-O2", "-Wno-address-of-packed-member", "-DMETRICS", f"-DTRIE_ALPHABET={alphabet}", f"-DMAX_TRIE_NODES={max_trie_nodes}", "-o", binary, driver],
+            check=True,
+        )
+
+        best = None
+        for _ in range(runs):
+            result = subprocess.run([binary, str(lookups)], input=names, capture_output=True, text=True)
+            if result.returncode:
+                os.remove(binary)
+                print(f"{name}: driver failed ({result.returncode})\n{result.stdout}{result.stderr}")
+                sys.exit(1)
+            out = result.stdout.split()
+            if best is None or float(out[3]) < float(best[3]):
+                best = out
+        os.remove(binary)
+
+        symbols, node_size, nodes = map(int, best[:3])
+        print(f"{name:22} {symbols:3} symbols, {node_size:4} B/node, {nodes:6} nodes = {node_size * nodes / 1024:8.1f} KiB, "
+              f"descent (best of {runs}): {float(best[3]):6.1f} ns/name, {float(best[4]):5.2f} ns/byte")
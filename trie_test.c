@@ -13,11 +13,43 @@
 #include <stdbool.h>
 #include <assert.h>
 #include <stdint.h>
+#ifdef SPILL_PENDING_AGE
+#include <sys/mman.h>
+#include <limits.h>
+#endif
+
+// Symbol classes the trie can store, pick them with -DTRIE_ALPHABET=... (-DTRIE_STRICT_ALPHABET to reject anything else)
+#define ALPHABET_LOWER 1
+#define ALPHABET_UPPER 2
+#define ALPHABET_DIGIT 4
+#define ALPHABET_UNDERSCORE 8
+
+#ifndef TRIE_ALPHABET
+#define TRIE_ALPHABET (ALPHABET_LOWER | ALPHABET_UPPER | ALPHABET_DIGIT | ALPHABET_UNDERSCORE)
+#endif
+
+#define ALPHABET_HAS(class) (!!(TRIE_ALPHABET & (class)))
 
 #define OFFSET_LOWER 0
-#define OFFSET_UPPER 26
-#define OFFSET_DIGIT 52
-#define OFFSET_UNDERSCORE 62
+#define OFFSET_UPPER (OFFSET_LOWER + 26 * ALPHABET_HAS(ALPHABET_LOWER))
+#define OFFSET_DIGIT (OFFSET_UPPER + 26 * ALPHABET_HAS(ALPHABET_UPPER))
+#define OFFSET_UNDERSCORE (OFFSET_DIGIT + 10 * ALPHABET_HAS(ALPHABET_DIGIT))
+#define TRIE_ALPHABET_SIZE (OFFSET_UNDERSCORE + ALPHABET_HAS(ALPHABET_UNDERSCORE))
+
+// Byte -> child slot, out-of-alphabet bytes (and '\0') map to TRIE_SLOT_INVALID
+#define TRIE_SLOT_INVALID 0xFF
+#define TRIE_SLOT(c)                                                                           \
+  (ALPHABET_HAS(ALPHABET_LOWER) && (c) >= 'a' && (c) <= 'z'   ? OFFSET_LOWER + (c) - 'a'      \
+   : ALPHABET_HAS(ALPHABET_UPPER) && (c) >= 'A' && (c) <= 'Z' ? OFFSET_UPPER + (c) - 'A'      \
+   : ALPHABET_HAS(ALPHABET_DIGIT) && (c) >= '0' && (c) <= '9' ? OFFSET_DIGIT + (c) - '0'      \
+   : ALPHABET_HAS(ALPHABET_UNDERSCORE) && (c) == '_'          ? OFFSET_UNDERSCORE             \
+                                                              : TRIE_SLOT_INVALID)
+#define TRIE_SLOT_4(c) TRIE_SLOT(c), TRIE_SLOT((c) + 1), TRIE_SLOT((c) + 2), TRIE_SLOT((c) + 3)
+#define TRIE_SLOT_16(c) TRIE_SLOT_4(c), TRIE_SLOT_4((c) + 4), TRIE_SLOT_4((c) + 8), TRIE_SLOT_4((c) + 12)
+#define TRIE_SLOT_64(c) TRIE_SLOT_16(c), TRIE_SLOT_16((c) + 16), TRIE_SLOT_16((c) + 32), TRIE_SLOT_16((c) + 48)
+#define TRIE_SLOT_256(c) TRIE_SLOT_64(c), TRIE_SLOT_64((c) + 64), TRIE_SLOT_64((c) + 128), TRIE_SLOT_64((c) + 192)
+
+_Static_assert(TRIE_ALPHABET_SIZE > 0 && TRIE_ALPHABET_SIZE < TRIE_SLOT_INVALID, "TRIE_ALPHABET must select at least one symbol class");
 
 #ifdef METRICS
 int numero_ricette = 0;
@@ -27,6 +59,9 @@ int numero_eliminazioni_ricette = 0;
 int numero_trie_nodes = 0;
 int numero_aggiunte_ingrediente_nuovo = 0;
 int numero_collisioni = 0;
+int numero_ordini_spillati = 0;
+int numero_ordini_ripescati = 0;
+int numero_max_ordini_spillati = 0;
 #endif
 
 /*****
@@ -45,6 +80,24 @@ int numero_collisioni = 0;
 #define MAX_TRIE_NODES 200
 #endif
 
+// Packed bitfields are rounded up to whole bytes anyway, so the child width only grows a byte at a time
+#if MAX_TRIE_NODES <= (1 << 8)
+#define TRIE_ID_BITS 8
+#elif MAX_TRIE_NODES <= (1 << 16)
+#define TRIE_ID_BITS 16
+#elif MAX_TRIE_NODES <= (1 << 24)
+#define TRIE_ID_BITS 24
+#else
+#define TRIE_ID_BITS 32
+#endif
+
+#ifdef SPILL_PENDING_AGE
+#ifndef MAX_SPILLED_ORDERS
+// Only reserves address space: pages are committed as the overflow store actually fills up
+#define MAX_SPILLED_ORDERS (1 << 22)
+#endif
+#endif
+
 // Prime number for the hash table size
 #define RECIPE_HT_BUCKET_COUNT 3001
 
@@ -86,6 +139,9 @@ typedef struct __attribute__((packed)) Ingredient
   int total_quantity;
   int last_expired_check_time;
   struct IngredientLot *lot_list;
+#ifdef SPILL_PENDING_AGE
+  int last_restock_time;
+#endif
 } Ingredient_t;
 
 typedef struct __attribute__((packed)) RecipeIngredient
@@ -96,6 +152,18 @@ typedef struct __attribute__((packed)) RecipeIngredient
   int uses;
 } RecipeIngredient_t;
 
+#ifdef SPILL_PENDING_AGE
+typedef uint32_t spill_id_t; // 0 is reserved as the "no order" sentinel
+
+// What's left of a long-pending order once it's evicted from order_queue: everything else can be rebuilt from its recipe
+typedef struct __attribute__((packed)) SpilledOrder
+{
+  int order_time;
+  int order_quantity;
+  spill_id_t next_spilled;
+} SpilledOrder_t;
+#endif
+
 typedef struct Recipe
 {
   int weight;
@@ -103,6 +171,16 @@ typedef struct Recipe
   char *name;
   RecipeIngredient_t *ingredients_list;
   struct Recipe *next_recipe;
+#ifdef SPILL_PENDING_AGE
+  spill_id_t spilled_head; // spilled orders of this recipe, in arrival order
+  spill_id_t spilled_tail;
+  int spilled_min_quantity; // lower bound, it isn't raised when the smallest order leaves
+  struct Recipe *next_spilled_recipe;
+  // merge cursor over the spilled orders, only meaningful while the recipe is woken
+  bool spilled_woken;
+  spill_id_t spilled_cursor;
+  spill_id_t spilled_cursor_prev;
+#endif
 #ifdef METRICS
   bool used;
 #endif
@@ -114,15 +192,17 @@ typedef uint32_t trie_id_t;
 
 typedef struct __attribute__((packed)) ChildField
 {
-  trie_id_t value : 20;
+  trie_id_t value : TRIE_ID_BITS;
 } ChildField_t;
 
 typedef struct __attribute__((packed)) TrieNode
 {
   void *dest;
-  ChildField_t children[26 * 2 + 10 + 1]; // [a-zA-Z0-9_]
+  ChildField_t children[TRIE_ALPHABET_SIZE]; // [a-zA-Z0-9_] by default
 } TrieNode_t;
 
+static const uint8_t trie_slot_table[256] = {TRIE_SLOT_256(0)};
+
 /* ********************************** HASH TABLE **********************************/
 
 typedef uint64_t Hash_t;
@@ -137,6 +217,13 @@ TrieNode_t *ingredients_root;
 
 Recipe_t *recipe_ht[RECIPE_HT_BUCKET_COUNT];
 
+#ifdef SPILL_PENDING_AGE
+SpilledOrder_t *spilled_order_pool;
+spill_id_t spilled_order_free_list = 0;
+Recipe_t *spilled_recipes = NULL; // recipes with at least one spilled order
+Recipe_t *woken_recipes = NULL;    // recipes whose spilled orders get rechecked in the current evaluation
+#endif
+
 int courier_interval;
 int courier_capacity;
 int current_time = 0;
@@ -170,6 +257,33 @@ trie_id_t trie_malloc()
   return trie_node_pool_alloc++;
 }
 
+#ifdef SPILL_PENDING_AGE
+// Replaces malloc for the spilled orders, returns 0 if the overflow store is full
+spill_id_t spill_malloc()
+{
+  static spill_id_t spilled_order_pool_alloc = 1;
+  spill_id_t id = spilled_order_free_list;
+  if (id)
+    spilled_order_free_list = spilled_order_pool[id].next_spilled;
+  else if (spilled_order_pool_alloc < MAX_SPILLED_ORDERS)
+    id = spilled_order_pool_alloc++;
+  else
+    return 0; // the order just stays in the queue, we're slower but still correct
+#ifdef METRICS
+  if ((int)(spilled_order_pool_alloc - 1) > numero_max_ordini_spillati)
+    numero_max_ordini_spillati = spilled_order_pool_alloc - 1;
+#endif
+  return id;
+}
+
+// Returns the slot to the free list
+void spill_free(spill_id_t id)
+{
+  spilled_order_pool[id].next_spilled = spilled_order_free_list;
+  spilled_order_free_list = id;
+}
+#endif
+
 // Skips to the end of the line in the file
 void go_to_line_end(FILE *file)
 {
@@ -177,74 +291,61 @@ void go_to_line_end(FILE *file)
     continue;
 }
 
-// Returns the requested node, creating it recursively if it doesn't exist
-TrieNode_t *trie_node_find_or_create(TrieNode_t *trie_root, char *key, bool create_if_missing)
+// Descends by one byte, returns false once the walk is over: at the end of the key, or with *current_node set to NULL on a miss
+static inline bool trie_node_step(TrieNode_t **current_node, unsigned char c, bool create_if_missing)
 {
-  TrieNode_t *current_node = trie_root;
-  for (unsigned int i = 0; /* condition checked inside loop */; i++)
+  unsigned int slot = trie_slot_table[c];
+  if (__builtin_expect(slot == TRIE_SLOT_INVALID, 0)) // '\0' is out of the alphabet too, so it costs no extra branch
   {
-    char c = key[i];
-    switch (c)
-    {
-    case '\0':
-      goto end_of_string;
-
-    case 'a' ... 'z':
-      if (!current_node->children[OFFSET_LOWER + c - 'a'].value)
-      {
-        if (!create_if_missing)
-          return NULL;
-
-        current_node->children[OFFSET_LOWER + c - 'a'].value = trie_malloc();
-      }
-      current_node = &trie_node_pool[current_node->children[OFFSET_LOWER + c - 'a'].value];
-      break;
-
-    case 'A' ... 'Z':
-      if (!current_node->children[OFFSET_UPPER + c - 'A'].value)
-      {
-        if (!create_if_missing)
-          return NULL;
-
-        current_node->children[OFFSET_UPPER + c - 'A'].value = trie_malloc();
-      }
-      current_node = &trie_node_pool[current_node->children[OFFSET_UPPER + c - 'A'].value];
-      break;
-
-    case '0' ... '9':
-      if (!current_node->children[OFFSET_DIGIT + c - '0'].value)
-      {
-        if (!create_if_missing)
-          return NULL;
-
-        current_node->children[OFFSET_DIGIT + c - '0'].value = trie_malloc();
-      }
-      current_node = &trie_node_pool[current_node->children[OFFSET_DIGIT + c - '0'].value];
-      break;
-
-    case '_':
-      if (!current_node->children[OFFSET_UNDERSCORE].value)
-      {
-        if (!create_if_missing)
-          return NULL;
+    if (!c)
+      return false;
+#ifdef TRIE_STRICT_ALPHABET
+    *current_node = NULL;
+    return false;
+#else
+    return true; // skipped, like it always was
+#endif
+  }
 
-        current_node->children[OFFSET_UNDERSCORE].value = trie_malloc();
-      }
-      current_node = &trie_node_pool[current_node->children[OFFSET_UNDERSCORE].value];
-      break;
+  trie_id_t child = (*current_node)->children[slot].value;
+  if (!child)
+  {
+    if (!create_if_missing)
+    {
+      *current_node = NULL;
+      return false;
     }
 
-    continue;
-  end_of_string:
-    break;
+    child = (*current_node)->children[slot].value = trie_malloc();
   }
-  return current_node;
+  *current_node = &trie_node_pool[child];
+  return true;
+}
+
+// Returns the requested node, creating it recursively if it doesn't exist (NULL on out-of-alphabet bytes in strict mode)
+TrieNode_t *trie_node_find_or_create(TrieNode_t *trie_root, char *key, bool create_if_missing)
+{
+  TrieNode_t *current_node = trie_root;
+  // unrolled by hand, four bytes per iteration: short-circuiting stops right at the terminator, so we never read past it
+  for (;; key += 4)
+    if (!trie_node_step(&current_node, key[0], create_if_missing) ||
+        !trie_node_step(&current_node, key[1], create_if_missing) ||
+        !trie_node_step(&current_node, key[2], create_if_missing) ||
+        !trie_node_step(&current_node, key[3], create_if_missing))
+      return current_node;
 }
 
 // Returns the ingredient, creating it if it doesn't exist
 Ingredient_t *ingredient_find_or_create(char *key)
 {
   TrieNode_t *node = trie_node_find_or_create(ingredients_root, key, true);
+#ifdef TRIE_STRICT_ALPHABET
+  if (!node)
+  {
+    printf("Ingredient \"%s\" is not in the trie alphabet! Rebuild with a wider TRIE_ALPHABET. Exiting...\n", key);
+    exit(1);
+  }
+#endif
   if (!node->dest)
   {
 #ifdef METRICS
@@ -336,6 +437,9 @@ void ingredient_replenish(TrieNode_t *trie_root, char *key, int quantity, int ex
 {
   Ingredient_t *ingredient = ingredient_find_or_create(key);
   IngredientLot_t *new_lot = calloc(sizeof(IngredientLot_t), 1);
+#ifdef SPILL_PENDING_AGE
+  ingredient->last_restock_time = current_time;
+#endif
   new_lot->quantity = quantity;
   new_lot->expiration_time = expiration;
   ingredient->total_quantity += quantity;
@@ -383,9 +487,8 @@ void clear_expired_lots(Ingredient_t *ingredient)
 }
 
 // Consumes the ingredients and returns true if the order is shippable, doesn't alter the pantry and returns false otherwise
-bool check_and_fill_order(Order_t *order)
+bool check_and_fill_order(Recipe_t *order_recipe, int order_quantity)
 {
-  Recipe_t *order_recipe = order->recipe;
   bool first_iteration;
 
   first_iteration = true;
@@ -398,7 +501,7 @@ bool check_and_fill_order(Order_t *order)
       clear_expired_lots(current_ingredient);
       current_ingredient->last_expired_check_time = current_time;
     }
-    if (current_ingredient->total_quantity < current_recipe_ingredient->quantity * order->order_quantity)
+    if (current_ingredient->total_quantity < current_recipe_ingredient->quantity * order_quantity)
     {
       // optimize by setting the failed ingredient as the first one
       order_recipe->ingredients_list = current_recipe_ingredient; // circular linked list
@@ -410,7 +513,7 @@ bool check_and_fill_order(Order_t *order)
   for (RecipeIngredient_t *current_recipe_ingredient = order_recipe->ingredients_list; current_recipe_ingredient != order_recipe->ingredients_list || first_iteration; current_recipe_ingredient = current_recipe_ingredient->next_ingredient)
   {
     first_iteration = false;
-    int quantity_needed = current_recipe_ingredient->quantity * order->order_quantity;
+    int quantity_needed = current_recipe_ingredient->quantity * order_quantity;
     Ingredient_t *ingredient = current_recipe_ingredient->ingredient;
 
     IngredientLot_t **current_lot_ptr = &ingredient->lot_list;
@@ -435,23 +538,234 @@ bool check_and_fill_order(Order_t *order)
   return true;
 }
 
+#ifdef SPILL_PENDING_AGE
+// Moves a pending order to its recipe's overflow list, returns false (leaving the order alone) if the store is full
+bool order_spill(Order_t *order)
+{
+  spill_id_t id = spill_malloc();
+  if (!id)
+    return false;
+
+  Recipe_t *recipe = order->recipe;
+  SpilledOrder_t *spilled = &spilled_order_pool[id];
+  spilled->order_time = order->order_time;
+  spilled->order_quantity = order->order_quantity;
+
+  // find the record it goes after (0 = list head) to keep the list in arrival order
+  spill_id_t previous_id;
+  if (recipe->spilled_woken)
+    previous_id = recipe->spilled_cursor_prev; // everything before the cursor is older, everything from it on is newer
+  else if (!recipe->spilled_head)
+  {
+    previous_id = 0;
+    recipe->next_spilled_recipe = spilled_recipes;
+    spilled_recipes = recipe;
+  }
+  else if (spilled_order_pool[recipe->spilled_tail].order_time < spilled->order_time)
+    previous_id = recipe->spilled_tail; // the usual case, orders age out in arrival order
+  else
+  {
+    // only after a full store made an older order stay behind in the queue
+    previous_id = 0;
+    for (spill_id_t current_id = recipe->spilled_head; current_id && spilled_order_pool[current_id].order_time < spilled->order_time; current_id = spilled_order_pool[current_id].next_spilled)
+      previous_id = current_id;
+  }
+
+  if (!recipe->spilled_head || spilled->order_quantity < recipe->spilled_min_quantity)
+    recipe->spilled_min_quantity = spilled->order_quantity;
+
+  if (previous_id)
+  {
+    spilled->next_spilled = spilled_order_pool[previous_id].next_spilled;
+    spilled_order_pool[previous_id].next_spilled = id;
+  }
+  else
+  {
+    spilled->next_spilled = recipe->spilled_head;
+    recipe->spilled_head = id;
+  }
+  if (!spilled->next_spilled)
+    recipe->spilled_tail = id;
+  if (recipe->spilled_woken)
+    recipe->spilled_cursor_prev = id; // it has already been checked in this evaluation
+
+  free(order);
+#ifdef METRICS
+  numero_ordini_spillati++;
+#endif
+  return true;
+}
+
+// Wakes every spilled recipe that uses an ingredient restocked at the current time, and that the pantry might now be able to fill.
+// The others can't have become shippable: without a restock their ingredients can only decrease
+void wake_restocked_recipes()
+{
+  Recipe_t *previous_recipe = NULL;
+  for (Recipe_t *recipe = spilled_recipes; recipe;)
+  {
+    Recipe_t *next_recipe = recipe->next_spilled_recipe;
+    bool restocked = false;
+    bool enough = true;
+    bool first_iteration = true;
+    // starts from the "last failed on" ingredient, and total_quantity only overestimates (expired lots are still in it)
+    for (RecipeIngredient_t *current_recipe_ingredient = recipe->ingredients_list; current_recipe_ingredient != recipe->ingredients_list || first_iteration; current_recipe_ingredient = current_recipe_ingredient->next_ingredient)
+    {
+      first_iteration = false;
+      if (current_recipe_ingredient->ingredient->total_quantity < current_recipe_ingredient->quantity * recipe->spilled_min_quantity)
+      {
+        enough = false;
+        break;
+      }
+      if (current_recipe_ingredient->ingredient->last_restock_time == current_time)
+        restocked = true;
+    }
+
+    if (restocked && enough)
+    {
+      if (previous_recipe)
+        previous_recipe->next_spilled_recipe = next_recipe;
+      else
+        spilled_recipes = next_recipe;
+      recipe->next_spilled_recipe = woken_recipes;
+      woken_recipes = recipe;
+      recipe->spilled_woken = true;
+      recipe->spilled_cursor = recipe->spilled_head;
+      recipe->spilled_cursor_prev = 0;
+    }
+    else
+      previous_recipe = recipe;
+    recipe = next_recipe;
+  }
+}
+
+// Rechecks in place, oldest first, the spilled orders of the woken recipes that arrived before order_time.
+// Only the ones that can be filled get paged back in, right after previous_order; returns the new previous order
+Order_t *evaluate_spilled_orders_before(int order_time, Order_t *previous_order)
+{
+  for (;;)
+  {
+    Recipe_t *oldest_recipe = NULL;
+    for (Recipe_t *recipe = woken_recipes; recipe; recipe = recipe->next_spilled_recipe)
+      if (recipe->spilled_cursor && spilled_order_pool[recipe->spilled_cursor].order_time < order_time &&
+          (!oldest_recipe || spilled_order_pool[recipe->spilled_cursor].order_time < spilled_order_pool[oldest_recipe->spilled_cursor].order_time))
+        oldest_recipe = recipe;
+    if (!oldest_recipe)
+      return previous_order;
+
+    spill_id_t id = oldest_recipe->spilled_cursor;
+    SpilledOrder_t *spilled = &spilled_order_pool[id];
+    if (!check_and_fill_order(oldest_recipe, spilled->order_quantity))
+    {
+      oldest_recipe->spilled_cursor_prev = id;
+      oldest_recipe->spilled_cursor = spilled->next_spilled;
+      continue;
+    }
+
+    Order_t *order = malloc(sizeof(Order_t));
+    order->order_time = spilled->order_time;
+    order->order_quantity = spilled->order_quantity;
+    order->order_weight = oldest_recipe->weight * spilled->order_quantity;
+    order->recipe = oldest_recipe;
+    order->recipe_name = oldest_recipe->name;
+    order->state = SHIPPABLE;
+    shippable_order_count++;
+    if (previous_order)
+    {
+      order->next_order = previous_order->next_order;
+      previous_order->next_order = order;
+    }
+    else
+    {
+      order->next_order = order_queue;
+      order_queue = order;
+    }
+    if (!order->next_order)
+      order_queue_tail = order;
+    previous_order = order;
+
+    // unlink the record, the cursor moves on but its predecessor stays the same
+    if (oldest_recipe->spilled_cursor_prev)
+      spilled_order_pool[oldest_recipe->spilled_cursor_prev].next_spilled = spilled->next_spilled;
+    else
+      oldest_recipe->spilled_head = spilled->next_spilled;
+    if (oldest_recipe->spilled_tail == id)
+      oldest_recipe->spilled_tail = oldest_recipe->spilled_cursor_prev;
+    oldest_recipe->spilled_cursor = spilled->next_spilled;
+    spill_free(id);
+#ifdef METRICS
+    numero_ordini_ripescati++;
+#endif
+  }
+}
+#endif
+
 // Evaluates orders in the pending queue and moves them to the shipping queue if they can be fulfilled
 void evaluate_pending_orders()
 {
+#ifdef SPILL_PENDING_AGE
+  // the woken spilled orders are merged in by arrival time, and orders that have been waiting for too long
+  // get evicted to the overflow store instead of being rechecked forever
+  Order_t *previous_order = NULL;
+  for (Order_t *current_order = order_queue; current_order;)
+  {
+    if (woken_recipes)
+      previous_order = evaluate_spilled_orders_before(current_order->order_time, previous_order);
+
+    Order_t *next_order = current_order->next_order;
+    if (current_order->state == PENDING)
+    {
+      if (check_and_fill_order(current_order->recipe, current_order->order_quantity))
+      {
+        current_order->state = SHIPPABLE;
+        shippable_order_count++;
+      }
+      else if (current_time - current_order->order_time > SPILL_PENDING_AGE && order_spill(current_order))
+      {
+        if (previous_order)
+          previous_order->next_order = next_order;
+        else
+          order_queue = next_order;
+        if (!next_order)
+          order_queue_tail = previous_order;
+        current_order = next_order;
+        continue;
+      }
+    }
+    previous_order = current_order;
+    current_order = next_order;
+  }
+
+  if (woken_recipes)
+    evaluate_spilled_orders_before(INT_MAX, previous_order);
+
+  // back to sleep, at least the ones that still have something spilled
+  while (woken_recipes)
+  {
+    Recipe_t *recipe = woken_recipes;
+    woken_recipes = recipe->next_spilled_recipe;
+    recipe->spilled_woken = false;
+    if (recipe->spilled_head)
+    {
+      recipe->next_spilled_recipe = spilled_recipes;
+      spilled_recipes = recipe;
+    }
+  }
+#else
   // Order_t *next_order;
   for (Order_t *current_order = order_queue; current_order; current_order = current_order->next_order)
-    if (current_order->state == PENDING && check_and_fill_order(current_order))
+    if (current_order->state == PENDING && check_and_fill_order(current_order->recipe, current_order->order_quantity))
     {
       current_order->state = SHIPPABLE;
       shippable_order_count++;
     }
+#endif
 }
 
 // Attempts to prepare the order and add it to the shipping queue, or if ingredients are missing, adds it to the pending queue
 void add_order(Order_t *new_order)
 {
   current_time++; // simulate the accurate expiration time of ingredients
-  if (check_and_fill_order(new_order))
+  if (check_and_fill_order(new_order->recipe, new_order->order_quantity))
   {
     new_order->state = SHIPPABLE;
     shippable_order_count++;
@@ -499,6 +813,7 @@ void courier()
   int actual_shippable_orders = 0;
   int remaining_capacity = courier_capacity;
 
+  Order_t *previous_order = NULL; // the tail must fall back to it if we pop the last order
   for (Order_t **current_order = &order_queue; *current_order;)
   {
     if ((*current_order)->state == SHIPPABLE)
@@ -509,9 +824,8 @@ void courier()
         shippable_order_array[actual_shippable_orders++] = *current_order;
         remaining_capacity -= (*current_order)->order_weight;
         if (order_queue_tail == *current_order)
-          order_queue_tail = *current_order = NULL;
-        else
-          *current_order = (*current_order)->next_order;
+          order_queue_tail = previous_order;
+        *current_order = (*current_order)->next_order;
         shippable_order_count--;
         // we no longer care about the .next_order field
       }
@@ -519,8 +833,11 @@ void courier()
         break;
     }
     else
+    {
       // move to the next order
+      previous_order = *current_order;
       current_order = &(*current_order)->next_order;
+    }
   }
 
   if (actual_shippable_orders == 0)
@@ -552,6 +869,10 @@ int main()
 {
   trie_node_pool = calloc(sizeof(TrieNode_t), MAX_TRIE_NODES);
   ingredients_root = &trie_node_pool[trie_malloc()];
+#ifdef SPILL_PENDING_AGE
+  spilled_order_pool = mmap(NULL, sizeof(SpilledOrder_t) * MAX_SPILLED_ORDERS, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  assert(spilled_order_pool != MAP_FAILED);
+#endif
   char recipe_name[256];
   char token[64];
 
@@ -624,6 +945,9 @@ int main()
         ingredient_replenish(ingredients_root, ingredient_name, ingredient_quantity, ingredient_expiration);
       }
       puts("rifornito");
+#ifdef SPILL_PENDING_AGE
+      wake_restocked_recipes(); // before the time increment, that's when the lots were stamped
+#endif
       current_time++;            // replenishments take one time unit
       evaluate_pending_orders(); // new ingredients might make some orders shippable
       current_time--;            // current_time is incremented at the end of the loop
@@ -660,17 +984,25 @@ int main()
   }
 
 #ifdef METRICS
-  printf("Numero ricette finale: %d (%d creazioni, %d eliminazioni, %d aggiungi_ricetta)\nNumero ingredienti aggiunti: %d\nNumero trie nodes (da %lu byte ciascuno): %d, per un totale di %ld KiB\n",
+  printf("Numero ricette finale: %d (%d creazioni, %d eliminazioni, %d aggiungi_ricetta)\nNumero ingredienti aggiunti: %d\nNumero trie nodes (da %lu byte ciascuno, alfabeto di %d simboli): %d, per un totale di %ld KiB\n",
          numero_ricette,
          numero_aggiunte_ricette,
          numero_eliminazioni_ricette,
          numero_comandi_aggiungi_ricetta,
          numero_aggiunte_ingrediente_nuovo,
          sizeof(TrieNode_t),
+         TRIE_ALPHABET_SIZE,
          numero_trie_nodes,
          numero_trie_nodes * sizeof(TrieNode_t) / 1024);
   printf("Dimensione della tabella hash delle ricette: %ld KiB (%d bucket)\n", RECIPE_HT_BUCKET_COUNT * sizeof(Recipe_t) / 1024, RECIPE_HT_BUCKET_COUNT);
   printf("Numero collisioni nelle aggiunte delle ricette: %d\n", numero_collisioni);
+#ifdef SPILL_PENDING_AGE
+  printf("Ordini spillati: %d, ripescati: %d, picco dello store di overflow: %d ordini (%ld KiB)\n",
+         numero_ordini_spillati,
+         numero_ordini_ripescati,
+         numero_max_ordini_spillati,
+         numero_max_ordini_spillati * sizeof(SpilledOrder_t) / 1024);
+#endif
 #endif
 
   return 0;